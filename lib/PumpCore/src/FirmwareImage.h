@@ -0,0 +1,150 @@
+/**
+ * Signed firmware image receiver.
+ * Hashes the image chunk by chunk as it streams into the flash backend and
+ * only finalises the slot once the ECDSA signature over that hash checks out.
+ * The signed data is "<build>\n" followed by the image, so an old signed
+ * image can't be relabelled as newer and replayed as a downgrade.
+ * Hardware-free so the same code runs in the native test build.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+
+const size_t FIRMWARE_SIG_MAX = 80;  // DER ECDSA P-256 signature
+
+// Hex string to bytes. Returns the byte count, or 0 if malformed or too long.
+inline size_t decodeHex(const char *hex, uint8_t *out, size_t maxLen) {
+  if (hex == nullptr) return 0;
+  size_t hexLen = strlen(hex);
+  size_t len = hexLen / 2;
+  if (hexLen % 2 != 0 || len == 0 || len > maxLen) return 0;
+  for (size_t i = 0; i < len; i++) {
+    char pair[3] = { hex[i * 2], hex[i * 2 + 1], 0 };
+    char *end;
+    out[i] = (uint8_t)strtoul(pair, &end, 16);
+    if (*end != 0 || pair[0] == '-' || pair[0] == '+' || pair[0] == ' ') return 0;
+  }
+  return len;
+}
+
+// Decimal build number (X-Firmware-Version). Returns false if malformed.
+inline bool parseFirmwareBuild(const char *text, uint32_t &build) {
+  if (text == nullptr || *text == 0 || strlen(text) > 9) return false;
+  build = 0;
+  for (const char *c = text; *c; c++) {
+    if (*c < '0' || *c > '9') return false;
+    build = build * 10 + (*c - '0');
+  }
+  return true;
+}
+
+// ECDSA check of a SHA-256 digest against a PEM public key
+inline bool verifyFirmwareSignature(const char *publicKeyPem, const uint8_t *digest,
+                                    const uint8_t *signature, size_t signatureLen) {
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  int err = mbedtls_pk_parse_public_key(&pk, (const unsigned char *)publicKeyPem, strlen(publicKeyPem) + 1);
+  if (err == 0) {
+    err = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, 32, signature, signatureLen);
+  }
+  mbedtls_pk_free(&pk);
+  return err == 0;
+}
+
+// Flash must provide: bool begin(size_t), size_t write(const uint8_t*, size_t),
+// bool end(), void abort(), const char* errorString().
+template <class Flash>
+class FirmwareReceiver {
+  public:
+    explicit FirmwareReceiver(Flash &flash) : _flash(flash) {}
+
+    // Validates the signature and build headers and opens the target slot.
+    // Only builds newer than runningBuild are accepted.
+    bool begin(size_t total, const char *signatureHex, const char *buildText,
+               uint32_t runningBuild, const char *publicKeyPem) {
+      _status = 0;
+      _error = nullptr;
+      _received = 0;
+      _total = total;
+      _build = 0;
+      _publicKey = publicKeyPem;
+
+      _signatureLen = decodeHex(signatureHex, _signature, FIRMWARE_SIG_MAX);
+      if (_signatureLen == 0) return reject(400, "Missing or invalid X-Firmware-Signature");
+      if (!parseFirmwareBuild(buildText, _build)) return reject(400, "Missing or invalid X-Firmware-Version");
+      if (_build <= runningBuild) return reject(409, "Firmware build is not newer than the running one");
+      if (total == 0) return reject(400, "Empty firmware image");
+      if (!_flash.begin(total)) return reject(413, _flash.errorString());
+
+      mbedtls_sha256_init(&_sha);
+      mbedtls_sha256_starts(&_sha, 0);
+      mbedtls_sha256_update(&_sha, (const uint8_t *)buildText, strlen(buildText));
+      mbedtls_sha256_update(&_sha, (const uint8_t *)"\n", 1);
+      _active = true;
+      return true;
+    }
+
+    // Hashes and writes one chunk; verifies and finalises after the last one
+    bool write(const uint8_t *data, size_t len) {
+      if (!_active) return false;
+      if (_received + len > _total) return reject(400, "Image larger than announced");
+
+      mbedtls_sha256_update(&_sha, data, len);
+      if (_flash.write(data, len) != len) return reject(500, _flash.errorString());
+      _received += len;
+
+      if (_received == _total) return finish();
+      return true;
+    }
+
+    // Abandons the image (if any) and records why
+    bool reject(int code, const char *message) {
+      if (_active) {
+        _flash.abort();
+        mbedtls_sha256_free(&_sha);
+        _active = false;
+      }
+      _status = code;
+      _error = message;
+      return false;
+    }
+
+    bool active() const { return _active; }
+    bool verified() const { return _status == 200; }
+    int status() const { return _status; }
+    const char* error() const { return _error; }
+    size_t received() const { return _received; }
+    uint32_t build() const { return _build; }
+
+  private:
+    bool finish() {
+      uint8_t digest[32];
+      mbedtls_sha256_finish(&_sha, digest);
+      if (!verifyFirmwareSignature(_publicKey, digest, _signature, _signatureLen)) {
+        return reject(403, "Signature verification failed");
+      }
+      if (!_flash.end()) return reject(500, _flash.errorString());
+
+      mbedtls_sha256_free(&_sha);
+      _active = false;
+      _status = 200;
+      return true;
+    }
+
+    Flash &_flash;
+    mbedtls_sha256_context _sha;
+    uint8_t _signature[FIRMWARE_SIG_MAX];
+    size_t _signatureLen = 0;
+    const char *_publicKey = nullptr;
+    size_t _total = 0;
+    size_t _received = 0;
+    uint32_t _build = 0;
+    bool _active = false;
+    int _status = 0;
+    const char *_error = nullptr;
+};
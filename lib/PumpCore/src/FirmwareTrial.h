@@ -0,0 +1,41 @@
+/**
+ * Trial period for a freshly switched firmware image.
+ * The image is confirmed by its first scheduled delivery tick. If the window
+ * ends without one, it is confirmed only when no tick is overdue, i.e. the
+ * loop kept servicing an idle schedule; otherwise it is rolled back.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class FirmwareTrial {
+  public:
+    enum Verdict { TRIAL_PENDING, TRIAL_CONFIRM, TRIAL_ROLLBACK };
+
+    void begin(uint32_t now, uint32_t windowMs) {
+      _active = true;
+      _start = now;
+      _window = windowMs;
+      _delivered = false;
+    }
+
+    void end() { _active = false; }
+
+    bool active() const { return _active; }
+
+    // Scheduled bolus/basal movement only; manual priming does not count
+    void recordDeliveryTick() { _delivered = true; }
+
+    Verdict evaluate(uint32_t now, bool deliveryOverdue) const {
+      if (!_active) return TRIAL_PENDING;
+      if (_delivered) return TRIAL_CONFIRM;
+      if (now - _start < _window) return TRIAL_PENDING;
+      return deliveryOverdue ? TRIAL_ROLLBACK : TRIAL_CONFIRM;
+    }
+
+  private:
+    bool _active = false;
+    bool _delivered = false;
+    uint32_t _start = 0;
+    uint32_t _window = 0;
+};
@@ -0,0 +1,72 @@
+/**
+ * Journal of volatile delivery state across a firmware switch.
+ * Written just before the reboot; kept until the image that reads it is
+ * confirmed, so a rollback boot can restore the same state.
+ * Store is anything with the Preferences put/get API.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct PumpJournal {
+  bool pumping;
+  float pendingUnits;
+  bool suspended;
+  bool tempBasalActive;
+  float tempBasalRate;
+  uint32_t tempBasalLeftMs;  // Rebased onto the next boot's millis()
+  uint32_t basalAgoMs;       // Time since the last basal tick
+};
+
+// Time left until a millis() deadline, safe across the 49-day wrap
+inline uint32_t journalTimeLeft(uint32_t now, bool active, uint32_t deadline) {
+  if (!active) return 0;
+  int32_t left = (int32_t)(deadline - now);
+  return left > 0 ? (uint32_t)left : 0;
+}
+
+// millis() times on the booting image, rebuilt from the journal's relative ones
+struct PumpJournalClock {
+  uint32_t tempBasalEnd;
+  uint32_t lastBasalTick;
+};
+
+inline PumpJournalClock rebasePumpJournal(const PumpJournal &journal, uint32_t now) {
+  PumpJournalClock clock;
+  clock.tempBasalEnd = now + journal.tempBasalLeftMs;
+  clock.lastBasalTick = now - journal.basalAgoMs;  // May wrap below zero
+  return clock;
+}
+
+template <class Store>
+void savePumpJournal(Store &store, const PumpJournal &journal) {
+  // Invalidate first: a trial image overwrites a journal that is still
+  // valid, and a torn write must never mix old and new fields
+  store.putBool("j_valid", false);
+  store.putBool("j_pumping", journal.pumping);
+  store.putFloat("j_pending", journal.pendingUnits);
+  store.putBool("j_susp", journal.suspended);
+  store.putBool("j_tmp", journal.tempBasalActive);
+  store.putFloat("j_tmp_rate", journal.tempBasalRate);
+  store.putULong("j_tmp_left", journal.tempBasalLeftMs);
+  store.putULong("j_basal_ago", journal.basalAgoMs);
+  store.putBool("j_valid", true);  // Last, so a torn write reads as no journal
+}
+
+template <class Store>
+bool loadPumpJournal(Store &store, PumpJournal &journal) {
+  if (!store.getBool("j_valid", false)) return false;
+  journal.pumping = store.getBool("j_pumping", false);
+  journal.pendingUnits = store.getFloat("j_pending", 0.0);
+  journal.suspended = store.getBool("j_susp", false);
+  journal.tempBasalActive = store.getBool("j_tmp", false);
+  journal.tempBasalRate = store.getFloat("j_tmp_rate", 0.0);
+  journal.tempBasalLeftMs = store.getULong("j_tmp_left", 0);
+  journal.basalAgoMs = store.getULong("j_basal_ago", 0);
+  return true;
+}
+
+template <class Store>
+void clearPumpJournal(Store &store) {
+  store.putBool("j_valid", false);
+}
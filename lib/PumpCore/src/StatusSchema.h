@@ -0,0 +1,242 @@
+/**
+ * Table-driven status schema.
+ * Every pump field that leaves the device is described once in
+ * STATUS_FIELDS. The SSE feed, the REST status/info bodies, the command
+ * "data" blocks and the OLED all render from it, straight into a
+ * caller-owned buffer with fixed-point numbers (no printf, no String).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FIRMWARE_VERSION "1.0.0"
+
+const size_t DEVICE_STATUS_MAX = 16;  // Longest getDeviceStatus() string
+
+// Snapshot of the pump, taken once per render
+struct PumpStatus {
+  const char* deviceStatus;
+  unsigned long long timestamp;
+  float delivered;
+  float remaining;
+  float capacity;
+  float basal;            // Active rate (temp or scheduled)
+  float pending;
+  float lastBolus;
+  float tempBasalRate;
+  uint32_t tempBasalMinutes;
+  uint32_t rewindDurationMs;
+  bool empty;
+  bool pumping;
+  bool rewinding;
+  bool suspended;
+  bool tempBasalActive;
+};
+
+enum StatusView : uint8_t {
+  VIEW_EVENTS     = 1 << 0,  // SSE "update" feed for the dashboard
+  VIEW_INFO       = 1 << 1,  // GET /api/device/info
+  VIEW_STATUS     = 1 << 2,  // GET /api/device/status
+  VIEW_COMMAND    = 1 << 3,  // suspend / resume / stop "data"
+  VIEW_BOLUS      = 1 << 4,  // bolus "data"
+  VIEW_TEMP_BASAL = 1 << 5,  // temp-basal "data"
+  VIEW_RESET      = 1 << 6,  // reset "data"
+  VIEW_OLED       = 1 << 7   // Plain-text values on the display
+};
+
+enum StatusSource : uint8_t {
+  SRC_TEXT,               // Constant string (text)
+  SRC_LITERAL,            // Constant JSON token written verbatim (text)
+  SRC_DEVICE_STATUS,
+  SRC_DELIVERED,
+  SRC_REMAINING,
+  SRC_CAPACITY,
+  SRC_BASAL,
+  SRC_PENDING,
+  SRC_LAST_BOLUS,
+  SRC_TEMP_BASAL_RATE,
+  SRC_TIMESTAMP,
+  SRC_TEMP_BASAL_MINUTES,
+  SRC_REWIND_MS,
+  SRC_EMPTY,              // Booleans last (see statusValueMax)
+  SRC_PUMPING,
+  SRC_REWINDING,
+  SRC_SUSPENDED
+};
+
+struct StatusField {
+  const char* key;      // nullptr for display-only rows (no JSON view)
+  StatusSource source;
+  uint8_t decimals;     // Fixed-point digits for unit fields (max 3)
+  uint8_t views;
+  const char* text;
+};
+
+constexpr StatusField STATUS_FIELDS[] = {
+  { "serialNumber",              SRC_TEXT,               0, VIEW_INFO,                  "ESP32-PUMP-001" },
+  { "firmwareVersion",           SRC_TEXT,               0, VIEW_INFO,                  FIRMWARE_VERSION },
+  { "hardwareVersion",           SRC_TEXT,               0, VIEW_INFO,                  "v1.0-WormDrive" },
+  { "deviceStatus",              SRC_DEVICE_STATUS,      0, VIEW_INFO | VIEW_STATUS | VIEW_COMMAND | VIEW_RESET | VIEW_OLED, nullptr },
+  { "batteryPercentage",         SRC_LITERAL,            0, VIEW_INFO | VIEW_STATUS,    "100" },
+  { "reservoirVolume",           SRC_REMAINING,          1, VIEW_INFO | VIEW_STATUS,    nullptr },
+  { "activationStage",           SRC_LITERAL,            0, VIEW_INFO,                  "5" },
+  { "communicationStatus",       SRC_TEXT,               0, VIEW_INFO,                  "CONNECTED" },
+  { "connectionState",           SRC_TEXT,               0, VIEW_STATUS,                "AUTHENTICATED_AND_READY" },
+  { "timestamp",                 SRC_TIMESTAMP,          0, VIEW_STATUS,                nullptr },
+  { "delivered",                 SRC_DELIVERED,          1, VIEW_EVENTS,                nullptr },
+  { "remaining",                 SRC_REMAINING,          1, VIEW_EVENTS | VIEW_OLED,    nullptr },
+  { "capacity",                  SRC_CAPACITY,           1, VIEW_EVENTS,                nullptr },
+  { "basal",                     SRC_BASAL,              1, VIEW_EVENTS | VIEW_OLED,    nullptr },
+  { "empty",                     SRC_EMPTY,              0, VIEW_EVENTS,                nullptr },
+  { "pumping",                   SRC_PUMPING,            0, VIEW_EVENTS,                nullptr },
+  { "rewinding",                 SRC_REWINDING,          0, VIEW_EVENTS,                nullptr },
+  { "suspended",                 SRC_SUSPENDED,          0, VIEW_EVENTS,                nullptr },
+  { "pending",                   SRC_PENDING,            1, VIEW_EVENTS | VIEW_OLED,    nullptr },
+  { nullptr,                     SRC_LAST_BOLUS,         1, VIEW_OLED,                  nullptr },
+  { "unitsDelivered",            SRC_LAST_BOLUS,         2, VIEW_BOLUS,                 nullptr },
+  { "startTime",                 SRC_TIMESTAMP,          0, VIEW_BOLUS,                 nullptr },
+  { "rate",                      SRC_TEMP_BASAL_RATE,    2, VIEW_TEMP_BASAL,            nullptr },
+  { "durationMinutes",           SRC_TEMP_BASAL_MINUTES, 0, VIEW_TEMP_BASAL,            nullptr },
+  { "estimatedRewindDurationMs", SRC_REWIND_MS,          0, VIEW_RESET,                 nullptr },
+};
+
+const size_t STATUS_FIELD_COUNT = sizeof(STATUS_FIELDS) / sizeof(STATUS_FIELDS[0]);
+
+constexpr size_t constLength(const char *s) {
+  return *s ? 1 + constLength(s + 1) : 0;
+}
+
+// Rows without a key are display-only; no JSON view may include them
+constexpr bool statusKeysValid(size_t i = 0) {
+  return i == STATUS_FIELD_COUNT ||
+         ((STATUS_FIELDS[i].key != nullptr || STATUS_FIELDS[i].views == VIEW_OLED) && statusKeysValid(i + 1));
+}
+static_assert(statusKeysValid(), "only VIEW_OLED rows may omit their key");
+
+// Longest text a field's value can render to
+constexpr size_t statusValueMax(const StatusField &f) {
+  return f.source == SRC_TEXT ? constLength(f.text) + 2
+       : f.source == SRC_LITERAL ? constLength(f.text)
+       : f.source == SRC_DEVICE_STATUS ? DEVICE_STATUS_MAX + 2
+       : f.source >= SRC_EMPTY ? 5
+       : f.source >= SRC_TIMESTAMP ? 20
+       : 12 + f.decimals;  // Sign, 10 digits, point
+}
+
+// Worst-case JSON size of a view, including braces and the terminator
+constexpr size_t statusViewCapacity(uint8_t view, size_t i = 0) {
+  return i == STATUS_FIELD_COUNT ? 3
+       : ((STATUS_FIELDS[i].views & view) ? constLength(STATUS_FIELDS[i].key) + 4 + statusValueMax(STATUS_FIELDS[i]) : 0)
+         + statusViewCapacity(view, i + 1);
+}
+
+// Bounded JSON emitter. Numbers are fixed-point, so no printf/dtostrf.
+class StatusWriter {
+  public:
+    StatusWriter(char *out, size_t cap) : _start(out), _pos(out), _end(out + cap - 1), _ok(true) {}
+
+    void put(char c) {
+      if (_pos < _end) *_pos++ = c;
+      else _ok = false;
+    }
+
+    void text(const char* s) { while (*s) put(*s++); }
+
+    void quoted(const char* s) { put('"'); text(s); put('"'); }
+
+    void boolean(bool b) { text(b ? "true" : "false"); }
+
+    void number(unsigned long long n) {
+      char digits[20];
+      int count = 0;
+      do { digits[count++] = '0' + (n % 10); n /= 10; } while (n > 0);
+      while (count > 0) put(digits[--count]);
+    }
+
+    // Out-of-range magnitudes (and NaN) clamp to FIXED_LIMIT / 10^decimals,
+    // so the conversion is defined and the output stays within 12 + decimals.
+    void fixed(float value, uint8_t decimals) {
+      static const uint32_t SCALE[] = { 1, 10, 100, 1000 };
+      static const float FIXED_LIMIT = 4000000000.0f;
+      uint32_t scale = SCALE[decimals < 3 ? decimals : 3];
+      if (value < 0) { put('-'); value = -value; }
+      float rounded = value * scale + 0.5f;
+      uint32_t scaled = rounded < FIXED_LIMIT ? (uint32_t)rounded : (uint32_t)FIXED_LIMIT;
+      number(scaled / scale);
+      if (scale == 1) return;
+      put('.');
+      uint32_t frac = scaled % scale;
+      for (uint32_t digit = scale / 10; digit > 0; digit /= 10) put('0' + (frac / digit) % 10);
+    }
+
+    // Length written, or 0 if the buffer was too small
+    size_t finish() {
+      *_pos = 0;
+      return _ok ? _pos - _start : 0;
+    }
+
+  private:
+    char *_start;
+    char *_pos;
+    char *_end;
+    bool _ok;
+};
+
+// Strings are quoted only in JSON
+inline void writeStatusValue(StatusWriter &w, const StatusField &f, const PumpStatus &s, bool json) {
+  switch (f.source) {
+    case SRC_TEXT:               json ? w.quoted(f.text) : w.text(f.text); break;
+    case SRC_LITERAL:            w.text(f.text); break;
+    case SRC_DEVICE_STATUS:      json ? w.quoted(s.deviceStatus) : w.text(s.deviceStatus); break;
+    case SRC_DELIVERED:          w.fixed(s.delivered, f.decimals); break;
+    case SRC_REMAINING:          w.fixed(s.remaining, f.decimals); break;
+    case SRC_CAPACITY:           w.fixed(s.capacity, f.decimals); break;
+    case SRC_BASAL:              w.fixed(s.basal, f.decimals); break;
+    case SRC_PENDING:            w.fixed(s.pending, f.decimals); break;
+    case SRC_LAST_BOLUS:         w.fixed(s.lastBolus, f.decimals); break;
+    case SRC_TEMP_BASAL_RATE:    w.fixed(s.tempBasalRate, f.decimals); break;
+    case SRC_TIMESTAMP:          w.number(s.timestamp); break;
+    case SRC_TEMP_BASAL_MINUTES: w.number(s.tempBasalMinutes); break;
+    case SRC_REWIND_MS:          w.number(s.rewindDurationMs); break;
+    case SRC_EMPTY:              w.boolean(s.empty); break;
+    case SRC_PUMPING:            w.boolean(s.pumping); break;
+    case SRC_REWINDING:          w.boolean(s.rewinding); break;
+    case SRC_SUSPENDED:          w.boolean(s.suspended); break;
+  }
+}
+
+inline void writeStatusMembers(StatusWriter &w, uint8_t view, const PumpStatus &status) {
+  bool first = true;
+  for (const StatusField &f : STATUS_FIELDS) {
+    if (!(f.views & view)) continue;
+    if (!first) w.put(',');
+    first = false;
+    w.quoted(f.key);
+    w.put(':');
+    writeStatusValue(w, f, status, true);
+  }
+}
+
+// JSON object for a view. Returns its length, or 0 if it didn't fit.
+inline size_t writeStatusView(char *out, size_t cap, uint8_t view, const PumpStatus &status) {
+  StatusWriter w(out, cap);
+  w.put('{');
+  writeStatusMembers(w, view, status);
+  w.put('}');
+  return w.finish();
+}
+
+// Plain-text value of the field a view shows for a source (e.g. the OLED).
+// An oversized value is truncated, never unterminated.
+inline const char* formatStatusValue(char *out, size_t cap, uint8_t view, StatusSource source, const PumpStatus &status) {
+  StatusWriter w(out, cap);
+  for (const StatusField &f : STATUS_FIELDS) {
+    if ((f.views & view) && f.source == source) {
+      writeStatusValue(w, f, status, false);
+      break;
+    }
+  }
+  w.finish();
+  return out;
+}
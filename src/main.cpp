@@ -1,20 +1,27 @@
 /**
  * ESP32 Insulin Pump - AndroidAPS API Compatible
  * Mechanics: 40:1 Worm Drive, 15T Pinion, 40mm stroke = 315 Units
- * Features: REST API, JSON, Temp Basal, Suspend, Audible Beeps, Auto-Rewind
+ * Features: REST API, JSON, Temp Basal, Suspend, Audible Beeps, Auto-Rewind, A/B OTA
  */
 #include <Arduino.h>
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <AsyncJson.h>
 #include <ArduinoJson.h>
 #include <ESP32Servo.h>
 #include <Preferences.h>
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SH110X.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 #include <time.h> 
+#include "FirmwareImage.h"
+#include "FirmwareTrial.h"
+#include "PumpJournal.h"
+#include "StatusSchema.h"
 
 // ==========================================
 // CONFIGURATION
@@ -22,6 +29,12 @@
 const char* ssid = "<NETWORK_SSID>";
 const char* password = "<WIFI-PASSWORD>";
 
+// ECDSA P-256 key that firmware images must be signed with (see README)
+const char firmware_public_key[] PROGMEM = R"rawliteral(-----BEGIN PUBLIC KEY-----
+<FIRMWARE-SIGNING-PUBLIC-KEY>
+-----END PUBLIC KEY-----
+)rawliteral";
+
 #define SERVO_PIN 18
 #define BUTTON_PIN 4
 #define BUZZER_PIN 25 // Piezo buzzer for feedback
@@ -38,12 +51,35 @@ const float TOTAL_UNITS = 315.0;
 const float DOSE_INCREMENT = 0.5;    
 const int TICK_DURATION_MS = 55;     // Motor run time for 0.5U (19.3 degrees)
 const int TICK_INTERVAL_MS = 1000;   // 1 second gap between bolus ticks
+const unsigned long TEMP_BASAL_MAX_MINS = 1440;  // Longest accepted temp basal (24 h)
 
 // Continuous Servo Commands
 const int SERVO_STOP = 1500;
 const int SERVO_FORWARD = 2000;
 const int SERVO_REVERSE = 1000;      
 
+// API Memory Budget (fixed, no per-request heap)
+const size_t API_ARENA_SIZE = 2048;  // Parse + build arena, reset per request
+const size_t API_BODY_MAX = 512;     // Largest accepted POST body
+const size_t API_RESPONSE_MAX = 512; // Largest serialised JSON response
+const int API_POOL_SIZE = 4;         // Concurrent in-flight responses / bodies
+const size_t API_DATA_MAX = statusViewCapacity(VIEW_COMMAND | VIEW_BOLUS | VIEW_TEMP_BASAL | VIEW_RESET);
+static_assert(statusViewCapacity(VIEW_INFO) <= API_RESPONSE_MAX, "info view outgrew API_RESPONSE_MAX");
+static_assert(statusViewCapacity(VIEW_STATUS) <= API_RESPONSE_MAX, "status view outgrew API_RESPONSE_MAX");
+const size_t API_COMMAND_ID_MAX = 64;    // Longest echoed commandId, JSON-escaped
+const size_t API_REPLY_WRAPPER = 80;     // {"commandId":,"status":"SUCCESS","timestamp":<20 digits>,"data":}
+const size_t API_REPLY_ARENA = 768;      // Arena left for a reply: one slot page plus its strings
+static_assert(API_REPLY_WRAPPER + API_COMMAND_ID_MAX + 2 + API_DATA_MAX <= API_RESPONSE_MAX,
+              "command reply can outgrow API_RESPONSE_MAX");
+
+// Firmware Update (A/B OTA)
+const uint32_t FIRMWARE_BUILD = 1;                        // Bump every release; only newer signed builds install
+const unsigned long FIRMWARE_SWITCH_DELAY_MS = 1000;      // Let the HTTP reply flush first
+const unsigned long FIRMWARE_SWITCH_WINDOW_MS = 100;      // Reboot only this soon after a bolus tick
+const unsigned long FIRMWARE_TRIAL_MS = 120000;           // New image must deliver (or idle cleanly) this long
+const unsigned long FIRMWARE_BACKSTOP_MS = 60000;         // Extra time before a hung loop() is rolled back
+const unsigned long DELIVERY_GRACE_MS = 2000;             // Lateness before a due tick counts as overdue
+
 // Standard Variables
 float totalCapacity = TOTAL_UNITS;
 float unitsDelivered = 0.0;
@@ -51,6 +87,7 @@ float unitsRemaining = TOTAL_UNITS;
 float basalRateUph = 0.0;            
 float lastBolusAmount = 0.0; 
 bool isReservoirEmpty = false;
+unsigned long statusUpdateMicros = 0; // Cost of the last SSE status serialisation
 
 // API & State Variables
 bool isPumping = false;              
@@ -61,6 +98,7 @@ bool isSuspended = false;
 // Temp Basal Variables
 bool isTempBasalActive = false;
 float tempBasalRate = 0.0;
+unsigned long tempBasalDurationMins = 0;
 unsigned long tempBasalEndMillis = 0;
 unsigned long lastBasalTick = 0;
 
@@ -75,6 +113,14 @@ bool stateDirty = false;
 unsigned long lastSaveTime = 0;
 const unsigned long SAVE_INTERVAL_MS = 30000; 
 
+// Firmware Update Variables
+SemaphoreHandle_t motionLock = NULL;     // Servo movement vs. flash writes
+AsyncWebServerRequest *firmwareOwner = nullptr;
+bool firmwareRebootPending = false;
+unsigned long firmwareReadyTime = 0;
+FirmwareTrial firmwareTrial;
+esp_timer_handle_t firmwareBackstopTimer = NULL;
+
 // Hardware Objects
 Servo pumpServo;
 AsyncWebServer server(80);
@@ -219,7 +265,7 @@ unsigned long long getEpochMs() {
   return (unsigned long long)(tv.tv_sec) * 1000 + (unsigned long long)(tv.tv_usec) / 1000;
 }
 
-String getDeviceStatus() {
+const char* getDeviceStatus() {
   if (isRewinding) return "PRIMING";
   if (isSuspended) return "SUSPENDED";
   if (isPumping) return "DELIVERING_BOLUS";
@@ -238,11 +284,36 @@ unsigned long getBasalIntervalMs() {
   return (unsigned long)(3600000.0 / (rate / DOSE_INCREMENT));
 }
 
+// Snapshot for the status schema (lib/PumpCore/src/StatusSchema.h)
+PumpStatus getPumpStatus() {
+  PumpStatus status;
+  status.deviceStatus = getDeviceStatus();
+  status.timestamp = getEpochMs();
+  status.delivered = unitsDelivered;
+  status.remaining = unitsRemaining;
+  status.capacity = TOTAL_UNITS;
+  status.basal = getActiveBasalRate();
+  status.pending = pendingUnits;
+  status.lastBolus = lastBolusAmount;
+  status.tempBasalRate = tempBasalRate;
+  status.tempBasalMinutes = tempBasalDurationMins;
+  status.rewindDurationMs = rewindDuration;
+  status.empty = isReservoirEmpty;
+  status.pumping = isPumping;
+  status.rewinding = isRewinding;
+  status.suspended = isSuspended;
+  status.tempBasalActive = isTempBasalActive;
+  return status;
+}
+
 // ==========================================
 // HARDWARE UI (SH1106 OLED)
 // ==========================================
 
 void updateDisplay() {
+  PumpStatus status = getPumpStatus();
+  char value[24];
+
   display.clearDisplay();
   display.setTextColor(SH110X_WHITE);
 
@@ -250,7 +321,7 @@ void updateDisplay() {
   display.setTextSize(1);
   display.setCursor(0, 0);
   display.print("ST: ");
-  display.print(getDeviceStatus());
+  display.print(formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_DEVICE_STATUS, status));
 
   // WiFi Bars
   if (WiFi.status() == WL_CONNECTED) {
@@ -273,27 +344,27 @@ void updateDisplay() {
   display.setCursor(0, 18);
   display.setTextSize(2);
   display.print("Rem:");
-  display.print(unitsRemaining, 1);
+  display.print(formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_REMAINING, status));
   display.print("U");
 
   // BOTTOM
   display.setTextSize(1);
   display.setCursor(0, 42);
   display.print("Basal: ");
-  display.print(getActiveBasalRate(), 1);
-  if (isTempBasalActive) display.print(" (TMP)");
+  display.print(formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_BASAL, status));
+  if (status.tempBasalActive) display.print(" (TMP)");
   else display.print(" U/h");
 
   display.setCursor(0, 54);
-  if (isSuspended) {
+  if (status.suspended) {
     display.print("*** SUSPENDED ***");
-  } else if (isPumping) {
+  } else if (status.pumping) {
     display.print("Bolus: ");
-    display.print(pendingUnits, 1);
+    display.print(formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_PENDING, status));
     display.print(" U Left");
   } else {
     display.print("Last: ");
-    display.print(lastBolusAmount, 1);
+    display.print(formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_LAST_BOLUS, status));
     display.print(" U");
   }
 
@@ -322,24 +393,54 @@ void loadStateFromNVS() {
   isReservoirEmpty = preferences.getBool("empty", false);
 }
 
+// Volatile delivery state that must survive a firmware switch or rollback
+void journalPumpState() {
+  saveStateToNVS();
+  unsigned long now = millis();
+  PumpJournal journal;
+  journal.pumping = isPumping;
+  journal.pendingUnits = pendingUnits;
+  journal.suspended = isSuspended;
+  journal.tempBasalActive = isTempBasalActive;
+  journal.tempBasalRate = tempBasalRate;
+  journal.tempBasalLeftMs = journalTimeLeft(now, isTempBasalActive, tempBasalEndMillis);
+  journal.basalAgoMs = now - lastBasalTick;
+  savePumpJournal(preferences, journal);
+  Serial.println("[NVS] Pump state journaled.");
+}
+
+void restorePumpJournal() {
+  PumpJournal journal;
+  if (!loadPumpJournal(preferences, journal)) return;
+
+  unsigned long now = millis();
+  PumpJournalClock clock = rebasePumpJournal(journal, now);
+  isPumping = journal.pumping;
+  pendingUnits = journal.pendingUnits;
+  isSuspended = journal.suspended;
+  isTempBasalActive = journal.tempBasalActive;
+  tempBasalRate = journal.tempBasalRate;
+  tempBasalEndMillis = clock.tempBasalEnd;
+  lastBasalTick = clock.lastBasalTick;
+  lastBolusTick = now;
+
+  // A trial image keeps the journal until confirmed, so a crash rollback
+  // boots the old image into the same state
+  if (!firmwareTrial.active()) clearPumpJournal(preferences);
+  Serial.println("[NVS] Pump state restored from journal.");
+}
+
 void updateClients() {
-  String json = "{";
-  json += "\"delivered\":" + String(unitsDelivered, 1) + ",";
-  json += "\"remaining\":" + String(unitsRemaining, 1) + ",";
-  json += "\"capacity\":" + String(TOTAL_UNITS, 1) + ",";
-  json += "\"basal\":" + String(getActiveBasalRate(), 1) + ",";
-  json += "\"empty\":" + String(isReservoirEmpty ? "true" : "false") + ",";
-  json += "\"pumping\":" + String(isPumping ? "true" : "false") + ",";
-  json += "\"rewinding\":" + String(isRewinding ? "true" : "false") + ",";
-  json += "\"suspended\":" + String(isSuspended ? "true" : "false") + ",";
-  json += "\"pending\":" + String(pendingUnits, 1);
-  json += "}";
-  events.send(json.c_str(), "update", millis());
+  char json[statusViewCapacity(VIEW_EVENTS)];
+  unsigned long start = micros();
+  size_t len = writeStatusView(json, sizeof(json), VIEW_EVENTS, getPumpStatus());
+  statusUpdateMicros = micros() - start;
+  if (len > 0) events.send(json, "update", millis());
   
   updateDisplay(); 
 }
 
-void triggerSingleTick(String type) {
+bool triggerSingleTick(String type) {
   if (isReservoirEmpty || unitsRemaining <= 0 || isRewinding || isSuspended) {
     if (unitsRemaining <= 0 && !isReservoirEmpty) {
       isReservoirEmpty = true;
@@ -347,7 +448,7 @@ void triggerSingleTick(String type) {
       stateDirty = true;
       updateClients();
     }
-    return;
+    return false;
   }
 
   unitsDelivered += DOSE_INCREMENT;
@@ -355,12 +456,480 @@ void triggerSingleTick(String type) {
   stateDirty = true; 
 
   // Physical Movement for Worm Gear (55ms)
+  // Held under motionLock so an OTA flash write can't stall the stop pulse
+  xSemaphoreTake(motionLock, portMAX_DELAY);
   pumpServo.writeMicroseconds(SERVO_FORWARD); 
   delay(TICK_DURATION_MS);                        
   pumpServo.writeMicroseconds(SERVO_STOP); 
+  xSemaphoreGive(motionLock);
 
   Serial.printf("[%s] Tick delivered. Rem: %.1f U\n", type.c_str(), unitsRemaining);
   updateClients();
+  return true;
+}
+
+// ==========================================
+// API MEMORY (ARENA & RESPONSE POOL)
+// ==========================================
+// All REST handlers run on the AsyncTCP task one at a time, so a single
+// bump arena serves both the parsed request and the response document.
+// It is rewound at the start of every request; nothing is freed piecemeal.
+
+struct ApiStats {
+  unsigned long requests;
+  unsigned long lastArenaAllocs;   // ArduinoJson arena allocations in the previous request
+  size_t lastArenaBytes;
+  long lastHeapBlocks;             // Change in allocated heap blocks across the previous handler
+  size_t peakArenaBytes;
+  unsigned long arenaFailures;     // Allocations refused because the arena was full
+  unsigned long poolMisses;        // Responses that had to fall back to the heap
+};
+ApiStats apiStats = {};
+
+class ApiArena : public ArduinoJson::Allocator {
+  public:
+    void reset() {
+      apiStats.requests++;
+      _used = 0;
+      _allocs = 0;
+      _last = nullptr;
+      _heapBlocks = allocatedHeapBlocks();
+    }
+
+    // Called once the handler has built its reply, for every request.
+    // The heap figure is process-wide, so loop() allocating at the same
+    // moment shows up too; it should read 0 on a quiet pump.
+    void record() {
+      apiStats.lastArenaAllocs = _allocs;
+      apiStats.lastArenaBytes = _used;
+      apiStats.lastHeapBlocks = (long)allocatedHeapBlocks() - (long)_heapBlocks;
+    }
+
+    size_t available() const { return sizeof(_buffer) - _used; }
+
+    void* allocate(size_t size) {
+      size_t blockSize = alignUp(size);
+      if (_used + HEADER + blockSize > sizeof(_buffer)) {
+        apiStats.arenaFailures++;
+        return nullptr;
+      }
+      uint8_t* block = _buffer + _used;
+      *(size_t*)block = blockSize;
+      _last = block + HEADER;
+      _used += HEADER + blockSize;
+      _allocs++;
+      if (_used > apiStats.peakArenaBytes) apiStats.peakArenaBytes = _used;
+      return _last;
+    }
+
+    void deallocate(void* ptr) {
+      // Released wholesale by reset()
+    }
+
+    void* reallocate(void* ptr, size_t newSize) {
+      if (ptr == nullptr) return allocate(newSize);
+      size_t oldSize = *(size_t*)((uint8_t*)ptr - HEADER);
+      size_t blockSize = alignUp(newSize);
+
+      // Last block can grow or shrink in place
+      if (ptr == _last) {
+        size_t start = (uint8_t*)ptr - _buffer;
+        if (start + blockSize > sizeof(_buffer)) {
+          apiStats.arenaFailures++;
+          return nullptr;
+        }
+        *(size_t*)((uint8_t*)ptr - HEADER) = blockSize;
+        _used = start + blockSize;
+        if (_used > apiStats.peakArenaBytes) apiStats.peakArenaBytes = _used;
+        return ptr;
+      }
+
+      if (blockSize <= oldSize) return ptr;
+      void* moved = allocate(newSize);
+      if (moved) memcpy(moved, ptr, oldSize);
+      return moved;
+    }
+
+  private:
+    static const size_t HEADER = 8;
+    static size_t alignUp(size_t size) { return (size + 7) & ~(size_t)7; }
+
+    static size_t allocatedHeapBlocks() {
+      multi_heap_info_t info;
+      heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+      return info.allocated_blocks;
+    }
+
+    alignas(8) uint8_t _buffer[API_ARENA_SIZE];
+    size_t _used = 0;
+    unsigned long _allocs = 0;
+    void* _last = nullptr;
+    size_t _heapBlocks = 0;
+};
+ApiArena apiArena;
+
+// Drop-in replacement for AsyncJsonResponse: the document lives in the
+// arena, the serialised body in the object itself, and the object in a
+// fixed pool (see operator new below).
+class PooledJsonResponse : public AsyncAbstractResponse {
+  public:
+    PooledJsonResponse(int code = 200) : _doc(&apiArena), _length(0), _sent(0) {
+      _code = code;
+      _contentType = "application/json";
+      _root = _doc.to<JsonObject>();
+    }
+
+    JsonObject getRoot() { return _root; }
+
+    size_t setLength() {
+      if (_doc.overflowed() || measureJson(_doc) >= sizeof(_buffer)) {
+        _code = 500;
+        _length = strlcpy(_buffer, "{\"error\":\"Response too large\"}", sizeof(_buffer));
+      } else {
+        _length = serializeJson(_doc, _buffer, sizeof(_buffer));
+      }
+      // The library deletes us after the ACK, possibly after another
+      // request has rewound the arena; drop every arena pointer now.
+      _doc.clear();
+      apiArena.record();
+      _contentLength = _length;
+      return _length;
+    }
+
+    // Body written straight from the status schema, bypassing the document
+    size_t setStatusView(uint8_t view) {
+      _length = writeStatusView(_buffer, sizeof(_buffer), view, getPumpStatus());
+      if (_length == 0) {
+        _code = 500;
+        _length = strlcpy(_buffer, "{\"error\":\"Response too large\"}", sizeof(_buffer));
+      }
+      _doc.clear();
+      apiArena.record();
+      _contentLength = _length;
+      return _length;
+    }
+
+    // Command "data" block, also written from the status schema
+    bool setStatusData(uint8_t view) {
+      char data[API_DATA_MAX];
+      size_t len = writeStatusView(data, sizeof(data), view, getPumpStatus());
+      if (len == 0) {
+        _code = 500;
+        _root["error"] = "Status too large";
+        return false;
+      }
+      _root["data"] = serialized(data, len);
+      return true;
+    }
+
+    bool _sourceValid() const { return _length > 0; }
+
+    size_t _fillBuffer(uint8_t *data, size_t len) {
+      size_t left = _length - _sent;
+      if (len > left) len = left;
+      memcpy(data, _buffer + _sent, len);
+      _sent += len;
+      return len;
+    }
+
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+
+  private:
+    JsonDocument _doc;
+    JsonObject _root;
+    char _buffer[API_RESPONSE_MAX];
+    size_t _length;
+    size_t _sent;
+};
+
+struct ResponseSlot {
+  alignas(PooledJsonResponse) uint8_t bytes[sizeof(PooledJsonResponse)];
+  bool inUse;
+};
+ResponseSlot responsePool[API_POOL_SIZE];
+
+void* PooledJsonResponse::operator new(size_t size) {
+  for (int i = 0; i < API_POOL_SIZE; i++) {
+    if (!responsePool[i].inUse && size <= sizeof(responsePool[i].bytes)) {
+      responsePool[i].inUse = true;
+      return responsePool[i].bytes;
+    }
+  }
+  apiStats.poolMisses++;
+  return ::operator new(size);
+}
+
+void PooledJsonResponse::operator delete(void* ptr) {
+  for (int i = 0; i < API_POOL_SIZE; i++) {
+    if (ptr == responsePool[i].bytes) {
+      responsePool[i].inUse = false;
+      return;
+    }
+  }
+  ::operator delete(ptr);
+}
+
+void sendJsonError(AsyncWebServerRequest *request, int code, const char* message) {
+  PooledJsonResponse *response = new PooledJsonResponse(code);
+  response->getRoot()["error"] = message;
+  response->setLength();
+  request->send(response);
+}
+
+// POST bodies are collected into fixed slots instead of the malloc'd
+// buffer AsyncCallbackJsonWebHandler uses.
+struct ApiBodySlot {
+  AsyncWebServerRequest *owner;
+  size_t length;
+  char data[API_BODY_MAX];
+};
+ApiBodySlot apiBodySlots[API_POOL_SIZE];
+
+ApiBodySlot* findBodySlot(AsyncWebServerRequest *request) {
+  for (int i = 0; i < API_POOL_SIZE; i++) {
+    if (apiBodySlots[i].owner == request) return &apiBodySlots[i];
+  }
+  return nullptr;
+}
+
+void releaseBodySlot(AsyncWebServerRequest *request) {
+  ApiBodySlot *slot = findBodySlot(request);
+  if (slot) slot->owner = nullptr;
+}
+
+bool isJsonRequest(AsyncWebServerRequest *request) {
+  return request->contentType().equalsIgnoreCase("application/json");
+}
+
+void handleApiBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (!isJsonRequest(request)) return;
+  if (total > API_BODY_MAX || index + len > API_BODY_MAX) return;
+
+  ApiBodySlot *slot = findBodySlot(request);
+  if (slot == nullptr && index == 0) {
+    slot = findBodySlot(nullptr);
+    if (slot == nullptr) return;
+    slot->owner = request;
+    slot->length = 0;
+    request->onDisconnect([request]() { releaseBodySlot(request); });
+  }
+  if (slot == nullptr) return;
+
+  memcpy(slot->data + index, data, len);
+  slot->length = index + len;
+}
+
+typedef void (*ApiJsonHandler)(AsyncWebServerRequest *request, JsonVariant &json);
+
+void onJsonCommand(const char* uri, ApiJsonHandler handler) {
+  server.on(uri, HTTP_POST, [handler](AsyncWebServerRequest *request) {
+    apiArena.reset();
+
+    // Non-JSON content types skip the CORS preflight, so a page on the
+    // LAN could otherwise POST commands from the browser.
+    if (!isJsonRequest(request)) {
+      releaseBodySlot(request);
+      sendJsonError(request, 415, "Expected application/json");
+      return;
+    }
+    if (request->contentLength() > API_BODY_MAX) {
+      releaseBodySlot(request);
+      sendJsonError(request, 413, "Request body too large");
+      return;
+    }
+    if (request->contentLength() == 0) {
+      sendJsonError(request, 400, "Missing JSON body");
+      return;
+    }
+
+    ApiBodySlot *slot = findBodySlot(request);
+    if (slot == nullptr) {
+      sendJsonError(request, 503, "Server busy");
+      return;
+    }
+    if (slot->length != request->contentLength()) {
+      releaseBodySlot(request);
+      sendJsonError(request, 400, "Incomplete JSON body");
+      return;
+    }
+
+    JsonDocument doc(&apiArena);
+    DeserializationError err = deserializeJson(doc, (const char*)slot->data, slot->length);
+    releaseBodySlot(request);
+    if (err) {
+      sendJsonError(request, 400, err == DeserializationError::NoMemory ? "Request too complex" : "Invalid JSON");
+      return;
+    }
+
+    // Handlers change pump state before they reply, so everything that
+    // could make the reply fail is rejected here, while nothing has run.
+    JsonVariant commandId = doc["commandId"];
+    if (!commandId.isNull() && (!commandId.is<const char*>() || measureJson(commandId) > API_COMMAND_ID_MAX + 2)) {
+      sendJsonError(request, 400, "Invalid commandId");
+      return;
+    }
+    if (apiArena.available() < API_REPLY_ARENA) {
+      sendJsonError(request, 400, "Request too complex");
+      return;
+    }
+
+    JsonVariant json = doc.as<JsonVariant>();
+    handler(request, json);
+  }, NULL, handleApiBody);
+}
+
+// ==========================================
+// FIRMWARE UPDATE (A/B OTA)
+// ==========================================
+// The image streams straight into the inactive OTA partition while loop()
+// keeps delivering. FirmwareReceiver hashes it chunk by chunk and only
+// finalises the slot once the ECDSA signature checks out. The reboot
+// itself waits for loop() to reach a quiet point between ticks.
+
+// Update, with every flash access held under motionLock
+struct LockedUpdate {
+  bool begin(size_t size) { return Update.begin(size, U_FLASH); }
+
+  size_t write(const uint8_t *data, size_t len) {
+    xSemaphoreTake(motionLock, portMAX_DELAY);
+    size_t written = Update.write(const_cast<uint8_t *>(data), len);
+    xSemaphoreGive(motionLock);
+    return written;
+  }
+
+  bool end() {
+    xSemaphoreTake(motionLock, portMAX_DELAY);
+    bool ok = Update.end();
+    xSemaphoreGive(motionLock);
+    return ok;
+  }
+
+  void abort() { Update.abort(); }
+
+  const char* errorString() { return Update.errorString(); }
+};
+LockedUpdate lockedUpdate;
+FirmwareReceiver<LockedUpdate> firmware(lockedUpdate);
+
+void abandonFirmwareUpdate(AsyncWebServerRequest *request) {
+  if (request != firmwareOwner) return;
+  if (firmware.active()) {
+    firmware.reject(400, "Upload interrupted");
+    Serial.println("[OTA] Upload interrupted.");
+  }
+  firmwareOwner = nullptr;
+}
+
+void handleFirmwareBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (index == 0) {
+    if (firmware.active() || firmwareRebootPending) return; // Answered with 409 in handleFirmwareRequest
+
+    firmwareOwner = request;
+    request->onDisconnect([request]() { abandonFirmwareUpdate(request); });
+
+    if (isRewinding) {
+      firmware.reject(409, "Device rewinding");
+    } else if (!request->contentType().equalsIgnoreCase("application/octet-stream")) {
+      firmware.reject(415, "Expected application/octet-stream");
+    } else {
+      firmware.begin(total, request->header("X-Firmware-Signature").c_str(),
+                     request->header("X-Firmware-Version").c_str(), FIRMWARE_BUILD, firmware_public_key);
+    }
+    if (!firmware.active()) {
+      Serial.printf("[OTA] Update rejected: %s\n", firmware.error());
+      return;
+    }
+    Serial.printf("[OTA] Receiving build %u (%u bytes) into %s\n", firmware.build(), total,
+                  esp_ota_get_next_update_partition(NULL)->label);
+  }
+
+  if (request != firmwareOwner || !firmware.active()) return;
+
+  firmware.write(data, len);
+  if (firmware.verified()) {
+    firmwareRebootPending = true;
+    firmwareReadyTime = millis();
+    Serial.println("[OTA] Image verified. Switching at next quiet point.");
+  } else if (!firmware.active()) {
+    Serial.printf("[OTA] Update rejected: %s\n", firmware.error());
+  }
+}
+
+void handleFirmwareRequest(AsyncWebServerRequest *request) {
+  apiArena.reset();
+  if (request != firmwareOwner) {
+    if (firmware.active() || firmwareRebootPending) sendJsonError(request, 409, "Firmware update already in progress");
+    else sendJsonError(request, 400, "Empty firmware image");
+    return;
+  }
+  if (!firmware.verified()) {
+    sendJsonError(request, firmware.status() ? firmware.status() : 500, firmware.error() ? firmware.error() : "Update failed");
+    return;
+  }
+
+  PooledJsonResponse *response = new PooledJsonResponse();
+  JsonObject root = response->getRoot();
+  root["status"] = "SUCCESS";
+  root["timestamp"] = getEpochMs();
+  JsonObject data = root["data"].to<JsonObject>();
+  data["bytesWritten"] = firmware.received();
+  data["partition"] = esp_ota_get_next_update_partition(NULL)->label;
+  data["rebootPending"] = true;
+
+  response->setLength();
+  request->send(response);
+}
+
+// The trial verdict is taken by loop() between ticks. This timer is only
+// the backstop for a loop() that never gets there.
+void onFirmwareBackstop(void *arg) {
+  Serial.println("[OTA] Trial loop hung. Rolling back.");
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+void startFirmwareTrial() {
+  esp_ota_img_states_t state;
+  if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK) return;
+  if (state != ESP_OTA_IMG_PENDING_VERIFY) return;
+
+  esp_timer_create_args_t args = {};
+  args.callback = &onFirmwareBackstop;
+  args.name = "fw_backstop";
+  esp_timer_create(&args, &firmwareBackstopTimer);
+  esp_timer_start_once(firmwareBackstopTimer, (uint64_t)(FIRMWARE_TRIAL_MS + FIRMWARE_BACKSTOP_MS) * 1000);
+  firmwareTrial.begin(millis(), FIRMWARE_TRIAL_MS);
+  Serial.printf("[OTA] New firmware on trial for %lu s.\n", FIRMWARE_TRIAL_MS / 1000);
+}
+
+// A scheduled tick that came due and still hasn't been delivered
+bool isDeliveryOverdue() {
+  if (isSuspended || isReservoirEmpty || isRewinding) return false;
+  unsigned long now = millis();
+  if (isPumping && now - lastBolusTick >= TICK_INTERVAL_MS + DELIVERY_GRACE_MS) return true;
+  if (getActiveBasalRate() > 0.01 && now - lastBasalTick >= getBasalIntervalMs() + DELIVERY_GRACE_MS) return true;
+  return false;
+}
+
+// Called from loop() only, so never mid-tick or mid-NVS write
+void serviceFirmwareTrial() {
+  FirmwareTrial::Verdict verdict = firmwareTrial.evaluate(millis(), isDeliveryOverdue());
+  if (verdict == FirmwareTrial::TRIAL_CONFIRM) {
+    esp_timer_stop(firmwareBackstopTimer);
+    esp_ota_mark_app_valid_cancel_rollback();
+    firmwareTrial.end();
+    clearPumpJournal(preferences);
+    Serial.println("[OTA] Firmware confirmed healthy.");
+  } else if (verdict == FirmwareTrial::TRIAL_ROLLBACK && !isRewinding) {
+    Serial.println("[OTA] No healthy delivery tick. Rolling back.");
+    journalPumpState();
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
+// Arduino core hook: we confirm the image ourselves from loop()
+extern "C" bool verifyRollbackLater() {
+  return true;
 }
 
 // ==========================================
@@ -370,154 +939,168 @@ void setupAPI() {
   
   // GET: /api/device/info
   server.on("/api/device/info", HTTP_GET, [](AsyncWebServerRequest *request){
-    AsyncJsonResponse *response = new AsyncJsonResponse();
-    JsonObject root = response->getRoot();
-    root["serialNumber"] = "ESP32-PUMP-001";
-    root["firmwareVersion"] = "1.0.0";
-    root["hardwareVersion"] = "v1.0-WormDrive";
-    root["deviceStatus"] = getDeviceStatus();
-    root["batteryPercentage"] = 100; 
-    root["reservoirVolume"] = unitsRemaining;
-    root["activationStage"] = 5;
-    root["communicationStatus"] = "CONNECTED";
-    
-    response->setLength();
+    apiArena.reset();
+    PooledJsonResponse *response = new PooledJsonResponse();
+    response->setStatusView(VIEW_INFO);
     request->send(response);
   });
 
   // GET: /api/device/status
   server.on("/api/device/status", HTTP_GET, [](AsyncWebServerRequest *request){
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    apiArena.reset();
+    PooledJsonResponse *response = new PooledJsonResponse();
+    response->setStatusView(VIEW_STATUS);
+    request->send(response);
+  });
+
+  // GET: /api/device/diagnostics (heap & API allocation counters)
+  server.on("/api/device/diagnostics", HTTP_GET, [](AsyncWebServerRequest *request){
+    apiArena.reset();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
-    root["deviceStatus"] = getDeviceStatus();
-    root["batteryPercentage"] = 100;
-    root["reservoirVolume"] = unitsRemaining;
-    root["connectionState"] = "AUTHENTICATED_AND_READY";
+    root["freeHeap"] = ESP.getFreeHeap();
+    root["minFreeHeap"] = ESP.getMinFreeHeap();
+    root["maxAllocHeap"] = ESP.getMaxAllocHeap();
+    root["apiRequests"] = apiStats.requests;
+    root["lastRequestArenaAllocs"] = apiStats.lastArenaAllocs;
+    root["lastRequestArenaBytes"] = apiStats.lastArenaBytes;
+    root["lastRequestHeapBlocks"] = apiStats.lastHeapBlocks;
+    root["peakArenaBytes"] = apiStats.peakArenaBytes;
+    root["arenaSize"] = API_ARENA_SIZE;
+    root["arenaFailures"] = apiStats.arenaFailures;
+    root["responsePoolMisses"] = apiStats.poolMisses;
+    root["runningPartition"] = esp_ota_get_running_partition()->label;
+    root["firmwareBuild"] = FIRMWARE_BUILD;
+    root["firmwareRebootPending"] = firmwareRebootPending;
+    root["statusUpdateMicros"] = statusUpdateMicros;
     root["timestamp"] = getEpochMs();
-    
+
     response->setLength();
     request->send(response);
   });
 
   // POST: /api/command/bolus
-  AsyncCallbackJsonWebHandler* bolusHandler = new AsyncCallbackJsonWebHandler("/api/command/bolus", [](AsyncWebServerRequest *request, JsonVariant &json) {
-    JsonObject jsonObj = json.as<JsonObject>();
-    String cmdId = jsonObj["commandId"] | "unknown";
-    
-    AsyncJsonResponse *response = new AsyncJsonResponse();
-    JsonObject root = response->getRoot();
-    root["commandId"] = cmdId;
-    root["timestamp"] = getEpochMs();
-
+  onJsonCommand("/api/command/bolus", [](AsyncWebServerRequest *request, JsonVariant &json) {
     if (isSuspended || isRewinding || isReservoirEmpty || isPumping) {
-      request->send(409, "application/json", "{\"error\":\"Device busy or suspended\"}");
+      sendJsonError(request, 409, "Device busy or suspended");
+      return;
+    }
+
+    JsonObject jsonObj = json.as<JsonObject>();
+    float units = jsonObj["units"].as<float>();
+    if (!jsonObj["units"].is<float>() || !(units > 0 && units <= TOTAL_UNITS)) {
+      sendJsonError(request, 400, "units must be a number in (0, 315]");
       return;
     }
 
-    pendingUnits = jsonObj["units"].as<float>();
+    pendingUnits = units;
     lastBolusAmount = pendingUnits;
     isPumping = true;
     lastBolusTick = millis();
     stateDirty = true;
 
+    PooledJsonResponse *response = new PooledJsonResponse();
+    JsonObject root = response->getRoot();
+    root["commandId"] = jsonObj["commandId"] | "unknown";
+    root["timestamp"] = getEpochMs();
     root["status"] = "SUCCESS";
-    JsonObject data = root.createNestedObject("data");
-    data["unitsDelivered"] = pendingUnits; 
-    data["startTime"] = getEpochMs();
+    response->setStatusData(VIEW_BOLUS);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(bolusHandler);
 
   // POST: /api/command/temp-basal
-  AsyncCallbackJsonWebHandler* tempBasalHandler = new AsyncCallbackJsonWebHandler("/api/command/temp-basal", [](AsyncWebServerRequest *request, JsonVariant &json) {
+  onJsonCommand("/api/command/temp-basal", [](AsyncWebServerRequest *request, JsonVariant &json) {
     JsonObject jsonObj = json.as<JsonObject>();
     float rate = jsonObj["rate"].as<float>();
-    int durationMins = jsonObj["durationMinutes"].as<int>();
+    if (!jsonObj["rate"].is<float>() || !(rate >= 0 && rate <= TOTAL_UNITS)) {
+      sendJsonError(request, 400, "rate must be a number in [0, 315] U/h");
+      return;
+    }
+    unsigned long durationMins = jsonObj["durationMinutes"].as<unsigned long>();
+    if (!jsonObj["durationMinutes"].is<unsigned long>() || durationMins == 0 || durationMins > TEMP_BASAL_MAX_MINS) {
+      sendJsonError(request, 400, "durationMinutes must be an integer in [1, 1440]");
+      return;
+    }
     
+    tempBasalDurationMins = durationMins;
     isTempBasalActive = true;
     tempBasalRate = rate;
-    tempBasalEndMillis = millis() + (durationMins * 60000);
+    tempBasalEndMillis = millis() + (tempBasalDurationMins * 60000);
 
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = jsonObj["commandId"] | "";
     root["status"] = "SUCCESS";
     root["timestamp"] = getEpochMs();
-    JsonObject data = root.createNestedObject("data");
-    data["rate"] = rate;
-    data["durationMinutes"] = durationMins;
+    response->setStatusData(VIEW_TEMP_BASAL);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(tempBasalHandler);
 
   // POST: /api/command/suspend
-  AsyncCallbackJsonWebHandler* suspendHandler = new AsyncCallbackJsonWebHandler("/api/command/suspend", [](AsyncWebServerRequest *request, JsonVariant &json) {
+  onJsonCommand("/api/command/suspend", [](AsyncWebServerRequest *request, JsonVariant &json) {
     isSuspended = true;
     isPumping = false; // Cancel active boluses
     pendingUnits = 0.0;
     
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = json["commandId"] | "";
     root["status"] = "SUCCESS";
     root["timestamp"] = getEpochMs();
-    root.createNestedObject("data")["deviceStatus"] = "SUSPENDED";
+    response->setStatusData(VIEW_COMMAND);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(suspendHandler);
 
   // POST: /api/command/resume
-  AsyncCallbackJsonWebHandler* resumeHandler = new AsyncCallbackJsonWebHandler("/api/command/resume", [](AsyncWebServerRequest *request, JsonVariant &json) {
+  onJsonCommand("/api/command/resume", [](AsyncWebServerRequest *request, JsonVariant &json) {
     isSuspended = false;
     
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = json["commandId"] | "";
     root["status"] = "SUCCESS";
     root["timestamp"] = getEpochMs();
-    root.createNestedObject("data")["deviceStatus"] = getDeviceStatus();
+    response->setStatusData(VIEW_COMMAND);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(resumeHandler);
 
   // POST: /api/command/stop
-  AsyncCallbackJsonWebHandler* stopHandler = new AsyncCallbackJsonWebHandler("/api/command/stop", [](AsyncWebServerRequest *request, JsonVariant &json) {
+  onJsonCommand("/api/command/stop", [](AsyncWebServerRequest *request, JsonVariant &json) {
     isPumping = false;
     pendingUnits = 0.0;
     basalRateUph = 0.0;
     isTempBasalActive = false;
     stateDirty = true;
     
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = json["commandId"] | "";
     root["status"] = "SUCCESS";
     root["timestamp"] = getEpochMs();
-    root.createNestedObject("data")["deviceStatus"] = "IDLE";
+    response->setStatusData(VIEW_COMMAND);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(stopHandler);
 
   // POST: /api/command/beep
-  AsyncCallbackJsonWebHandler* beepHandler = new AsyncCallbackJsonWebHandler("/api/command/beep", [](AsyncWebServerRequest *request, JsonVariant &json) {
+  onJsonCommand("/api/command/beep", [](AsyncWebServerRequest *request, JsonVariant &json) {
     tone(BUZZER_PIN, 2000, 300); // Fire piezo buzzer
     
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = json["commandId"] | "";
     root["status"] = "SUCCESS";
@@ -526,12 +1109,11 @@ void setupAPI() {
     response->setLength();
     request->send(response);
   });
-  server.addHandler(beepHandler);
 
   // POST: /api/command/reset (PHYSICAL REWIND LOGIC)
-  AsyncCallbackJsonWebHandler* resetHandler = new AsyncCallbackJsonWebHandler("/api/command/reset", [](AsyncWebServerRequest *request, JsonVariant &json) {
-    if (isPumping || isRewinding || isSuspended) {
-      request->send(409, "application/json", "{\"error\":\"Device busy or suspended\"}");
+  onJsonCommand("/api/command/reset", [](AsyncWebServerRequest *request, JsonVariant &json) {
+    if (isPumping || isRewinding || isSuspended || firmware.active() || firmwareRebootPending) {
+      sendJsonError(request, 409, "Device busy or suspended");
       return;
     }
 
@@ -552,20 +1134,20 @@ void setupAPI() {
       saveStateToNVS();
     }
 
-    AsyncJsonResponse *response = new AsyncJsonResponse();
+    PooledJsonResponse *response = new PooledJsonResponse();
     JsonObject root = response->getRoot();
     root["commandId"] = json["commandId"] | "reset_cmd";
     root["status"] = "SUCCESS";
     root["timestamp"] = getEpochMs();
-    JsonObject data = root.createNestedObject("data");
-    data["deviceStatus"] = "PRIMING";
-    data["estimatedRewindDurationMs"] = rewindDuration;
+    response->setStatusData(VIEW_RESET);
     
     response->setLength();
     request->send(response);
     updateClients();
   });
-  server.addHandler(resetHandler);
+
+  // POST: /api/firmware (raw signed image, streamed into the inactive OTA slot)
+  server.on("/api/firmware", HTTP_POST, handleFirmwareRequest, NULL, handleFirmwareBody);
 }
 
 // ==========================================
@@ -573,10 +1155,15 @@ void setupAPI() {
 // ==========================================
 void setup() {
   Serial.begin(115200);
+  motionLock = xSemaphoreCreateMutex();
+
+  // Arm rollback first, so a hang anywhere below still reverts the image
+  startFirmwareTrial();
 
   // Load NVS State
   preferences.begin("pump-state", false);
   loadStateFromNVS();
+  restorePumpJournal();
 
   // Initialize OLED
   delay(250); 
@@ -597,15 +1184,14 @@ void setup() {
   pinMode(BUTTON_PIN, INPUT_PULLUP);
   pinMode(BUZZER_PIN, OUTPUT);
 
-  // Initialize WiFi
+  // Initialize WiFi. Not waited for: a journal restored above must keep
+  // delivering from loop() even if the access point is down.
   WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
   WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) { delay(500); Serial.print("."); }
   
-  // Initialize NTP Time (For REST API Epoch ms)
+  // Initialize NTP Time (For REST API Epoch ms); SNTP syncs once WiFi is up
   configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-
-  Serial.println("\nConnected! IP: " + WiFi.localIP().toString());
   updateDisplay(); 
 
   // Web Dashboard Route
@@ -663,7 +1249,7 @@ void loop() {
   if (isPumping && !isRewinding && !isSuspended) {
     if (millis() - lastBolusTick >= TICK_INTERVAL_MS) {
       if (pendingUnits > 0.01 && !isReservoirEmpty) {
-        triggerSingleTick("BOLUS");
+        if (triggerSingleTick("BOLUS")) firmwareTrial.recordDeliveryTick();
         pendingUnits -= DOSE_INCREMENT;
         lastBolusTick = millis(); 
       } 
@@ -681,7 +1267,7 @@ void loop() {
     unsigned long basalInterval = getBasalIntervalMs();
     if (millis() - lastBasalTick >= basalInterval) {
       if (!isPumping || (millis() - lastBolusTick > 200)) { 
-        triggerSingleTick("BASAL");
+        if (triggerSingleTick("BASAL")) firmwareTrial.recordDeliveryTick();
         lastBasalTick = millis();
       }
     }
@@ -693,7 +1279,26 @@ void loop() {
     lastSaveTime = millis();
   }
 
-  // 7. KEEP-ALIVE UI UPDATES
+  // 7. FIRMWARE TRIAL & SWITCH
+  if (firmwareTrial.active()) serviceFirmwareTrial();
+  if (firmwareRebootPending && !isRewinding && millis() - firmwareReadyTime >= FIRMWARE_SWITCH_DELAY_MS) {
+    if (!isPumping || millis() - lastBolusTick < FIRMWARE_SWITCH_WINDOW_MS) {
+      journalPumpState();
+      Serial.println("[OTA] Rebooting into new firmware.");
+      ESP.restart();
+    }
+  }
+
+  // 8. WIFI STATUS (connects in the background)
+  static bool wifiConnected = false;
+  if ((WiFi.status() == WL_CONNECTED) != wifiConnected) {
+    wifiConnected = !wifiConnected;
+    if (wifiConnected) Serial.println("[WIFI] Connected! IP: " + WiFi.localIP().toString());
+    else Serial.println("[WIFI] Disconnected, retrying in the background.");
+    updateDisplay();
+  }
+
+  // 9. KEEP-ALIVE UI UPDATES
   static unsigned long lastUpdate = 0;
   if (millis() - lastUpdate > 3000) { 
     updateClients();
@@ -0,0 +1,267 @@
+/**
+ * Host tests for the signed OTA receiver.
+ * FakeFlash stands in for Update; chunks are fed as /api/firmware's body
+ * handler receives them from the HTTP stack.
+ */
+#include <unity.h>
+#include <vector>
+#include "FirmwareImage.h"
+
+// Throwaway P-256 test key and its signature over makeImage() as build 2,
+// made with the openssl commands from the README's "Firmware Updates" section
+static const char TEST_PUBLIC_KEY[] = R"rawliteral(-----BEGIN PUBLIC KEY-----
+MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEa5MIleBTYBYMaOWU49+ovrf6BeP/
+P9EIw7gPJHb1GsG/Wgz1H+nwosc7QqQMVD6VJhMlTYc5il2aA+c8nayo3Q==
+-----END PUBLIC KEY-----
+)rawliteral";
+
+static const char TEST_SIGNATURE[] =
+  "304402203771aa26f7e4820ae3f211249eea2d902dc6a44c835e78ff46bd95f3b3424e96"
+  "02200f7384d8e56af143b6b19603ee74221e2e40c0b10b4dab3852d9016132df4f6d";
+
+static const char TEST_BUILD[] = "2";
+static const uint32_t RUNNING_BUILD = 1;
+
+static const char PLACEHOLDER_KEY[] = "-----BEGIN PUBLIC KEY-----\n<FIRMWARE-SIGNING-PUBLIC-KEY>\n-----END PUBLIC KEY-----\n";
+
+static const size_t IMAGE_SIZE = 3000;
+static const size_t TCP_CHUNK = 1436;
+
+struct FakeFlash {
+  std::vector<uint8_t> data;
+  size_t capacity = 1310720;
+  bool begun = false;
+  bool ended = false;
+  bool aborted = false;
+  bool failWrites = false;
+
+  bool begin(size_t size) { begun = size <= capacity; return begun; }
+  size_t write(const uint8_t *chunk, size_t len) {
+    if (failWrites) return 0;
+    data.insert(data.end(), chunk, chunk + len);
+    return len;
+  }
+  bool end() { ended = true; return true; }
+  void abort() { aborted = true; }
+  const char* errorString() { return "fake flash error"; }
+};
+
+static std::vector<uint8_t> makeImage() {
+  std::vector<uint8_t> image(IMAGE_SIZE);
+  for (size_t i = 0; i < IMAGE_SIZE; i++) image[i] = (uint8_t)(i * 31 + 7);
+  return image;
+}
+
+// Mirrors handleFirmwareBody: begin on index 0, then one write per chunk
+static bool upload(FirmwareReceiver<FakeFlash> &receiver, const std::vector<uint8_t> &image,
+                   const char *signature, const char *key,
+                   const char *build = TEST_BUILD, uint32_t runningBuild = RUNNING_BUILD) {
+  if (!receiver.begin(image.size(), signature, build, runningBuild, key)) return false;
+  for (size_t index = 0; index < image.size() && receiver.active(); index += TCP_CHUNK) {
+    size_t len = image.size() - index < TCP_CHUNK ? image.size() - index : TCP_CHUNK;
+    receiver.write(image.data() + index, len);
+  }
+  return receiver.verified();
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_decode_hex_valid(void) {
+  uint8_t out[4];
+  TEST_ASSERT_EQUAL(3, decodeHex("00aFff", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0x00, out[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xAF, out[1]);
+  TEST_ASSERT_EQUAL_HEX8(0xFF, out[2]);
+}
+
+void test_decode_hex_rejects_malformed(void) {
+  uint8_t out[4];
+  TEST_ASSERT_EQUAL(0, decodeHex(nullptr, out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("abc", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("zz", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("1-", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("-1", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex(" 1", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("0x", out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, decodeHex("0011223344", out, sizeof(out)));
+}
+
+void test_signature_accepts_valid_digest(void) {
+  std::vector<uint8_t> image = makeImage();
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, (const uint8_t *)"2\n", 2);
+  mbedtls_sha256_update(&sha, image.data(), image.size());
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+
+  uint8_t signature[FIRMWARE_SIG_MAX];
+  size_t len = decodeHex(TEST_SIGNATURE, signature, sizeof(signature));
+  TEST_ASSERT_TRUE(verifyFirmwareSignature(TEST_PUBLIC_KEY, digest, signature, len));
+
+  digest[0] ^= 0x01;
+  TEST_ASSERT_FALSE(verifyFirmwareSignature(TEST_PUBLIC_KEY, digest, signature, len));
+}
+
+void test_signature_rejects_placeholder_key(void) {
+  uint8_t digest[32] = {};
+  uint8_t signature[FIRMWARE_SIG_MAX];
+  size_t len = decodeHex(TEST_SIGNATURE, signature, sizeof(signature));
+  TEST_ASSERT_FALSE(verifyFirmwareSignature(PLACEHOLDER_KEY, digest, signature, len));
+}
+
+void test_parse_build(void) {
+  uint32_t build;
+  TEST_ASSERT_TRUE(parseFirmwareBuild("2", build));
+  TEST_ASSERT_EQUAL_UINT32(2, build);
+  TEST_ASSERT_TRUE(parseFirmwareBuild("999999999", build));
+  TEST_ASSERT_EQUAL_UINT32(999999999, build);
+  TEST_ASSERT_FALSE(parseFirmwareBuild(nullptr, build));
+  TEST_ASSERT_FALSE(parseFirmwareBuild("", build));
+  TEST_ASSERT_FALSE(parseFirmwareBuild("-2", build));
+  TEST_ASSERT_FALSE(parseFirmwareBuild("2a", build));
+  TEST_ASSERT_FALSE(parseFirmwareBuild("1.0.0", build));
+  TEST_ASSERT_FALSE(parseFirmwareBuild("1234567890", build));
+}
+
+void test_stream_signed_image(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+  std::vector<uint8_t> image = makeImage();
+
+  TEST_ASSERT_TRUE(upload(receiver, image, TEST_SIGNATURE, TEST_PUBLIC_KEY));
+  TEST_ASSERT_EQUAL(200, receiver.status());
+  TEST_ASSERT_EQUAL(IMAGE_SIZE, receiver.received());
+  TEST_ASSERT_TRUE(flash.ended);
+  TEST_ASSERT_FALSE(flash.aborted);
+  TEST_ASSERT_TRUE(flash.data == image);
+  TEST_ASSERT_EQUAL_UINT32(2, receiver.build());
+}
+
+void test_stream_tampered_image_is_not_finalised(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+  std::vector<uint8_t> image = makeImage();
+  image[2000] ^= 0x80;
+
+  TEST_ASSERT_FALSE(upload(receiver, image, TEST_SIGNATURE, TEST_PUBLIC_KEY));
+  TEST_ASSERT_EQUAL(403, receiver.status());
+  TEST_ASSERT_FALSE(flash.ended);
+  TEST_ASSERT_TRUE(flash.aborted);
+}
+
+void test_stream_rejects_missing_signature(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), "", TEST_PUBLIC_KEY));
+  TEST_ASSERT_EQUAL(400, receiver.status());
+  TEST_ASSERT_FALSE(flash.begun);
+}
+
+void test_stream_rejects_missing_build(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY, ""));
+  TEST_ASSERT_EQUAL(400, receiver.status());
+  TEST_ASSERT_FALSE(flash.begun);
+}
+
+void test_stream_rejects_downgrade(void) {
+  // A validly signed build 2 is refused once build 2 or later is running
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY, TEST_BUILD, 2));
+  TEST_ASSERT_EQUAL(409, receiver.status());
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY, TEST_BUILD, 5));
+  TEST_ASSERT_EQUAL(409, receiver.status());
+  TEST_ASSERT_FALSE(flash.begun);
+}
+
+void test_stream_rejects_relabelled_build(void) {
+  // Build 2's signature presented as build 6 to get past a build 5 device
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY, "6", 5));
+  TEST_ASSERT_EQUAL(403, receiver.status());
+  TEST_ASSERT_FALSE(flash.ended);
+  TEST_ASSERT_TRUE(flash.aborted);
+}
+
+void test_stream_rejects_oversized_image(void) {
+  FakeFlash flash;
+  flash.capacity = IMAGE_SIZE - 1;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY));
+  TEST_ASSERT_EQUAL(413, receiver.status());
+}
+
+void test_stream_rejects_bytes_past_announced_size(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+  std::vector<uint8_t> image = makeImage();
+
+  TEST_ASSERT_TRUE(receiver.begin(100, TEST_SIGNATURE, TEST_BUILD, RUNNING_BUILD, TEST_PUBLIC_KEY));
+  TEST_ASSERT_FALSE(receiver.write(image.data(), 101));
+  TEST_ASSERT_EQUAL(400, receiver.status());
+  TEST_ASSERT_TRUE(flash.aborted);
+}
+
+void test_stream_flash_write_failure(void) {
+  FakeFlash flash;
+  flash.failWrites = true;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+
+  TEST_ASSERT_FALSE(upload(receiver, makeImage(), TEST_SIGNATURE, TEST_PUBLIC_KEY));
+  TEST_ASSERT_EQUAL(500, receiver.status());
+  TEST_ASSERT_EQUAL_STRING("fake flash error", receiver.error());
+  TEST_ASSERT_TRUE(flash.aborted);
+}
+
+void test_stream_interrupted_upload(void) {
+  FakeFlash flash;
+  FirmwareReceiver<FakeFlash> receiver(flash);
+  std::vector<uint8_t> image = makeImage();
+
+  TEST_ASSERT_TRUE(receiver.begin(image.size(), TEST_SIGNATURE, TEST_BUILD, RUNNING_BUILD, TEST_PUBLIC_KEY));
+  TEST_ASSERT_TRUE(receiver.write(image.data(), TCP_CHUNK));
+  receiver.reject(400, "Upload interrupted");
+  TEST_ASSERT_FALSE(receiver.active());
+  TEST_ASSERT_FALSE(receiver.verified());
+  TEST_ASSERT_TRUE(flash.aborted);
+  TEST_ASSERT_FALSE(flash.ended);
+
+  // The same receiver (a global on the device) takes the next upload
+  flash.data.clear();
+  TEST_ASSERT_TRUE(upload(receiver, image, TEST_SIGNATURE, TEST_PUBLIC_KEY));
+  TEST_ASSERT_TRUE(flash.ended);
+  TEST_ASSERT_TRUE(flash.data == image);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_decode_hex_valid);
+  RUN_TEST(test_decode_hex_rejects_malformed);
+  RUN_TEST(test_signature_accepts_valid_digest);
+  RUN_TEST(test_signature_rejects_placeholder_key);
+  RUN_TEST(test_parse_build);
+  RUN_TEST(test_stream_signed_image);
+  RUN_TEST(test_stream_tampered_image_is_not_finalised);
+  RUN_TEST(test_stream_rejects_missing_signature);
+  RUN_TEST(test_stream_rejects_missing_build);
+  RUN_TEST(test_stream_rejects_downgrade);
+  RUN_TEST(test_stream_rejects_relabelled_build);
+  RUN_TEST(test_stream_rejects_oversized_image);
+  RUN_TEST(test_stream_rejects_bytes_past_announced_size);
+  RUN_TEST(test_stream_flash_write_failure);
+  RUN_TEST(test_stream_interrupted_upload);
+  return UNITY_END();
+}
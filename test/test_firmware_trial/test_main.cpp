@@ -0,0 +1,70 @@
+/**
+ * Host tests for the post-update trial verdict.
+ */
+#include <unity.h>
+#include "FirmwareTrial.h"
+
+static const uint32_t WINDOW = 120000;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_inactive_trial_never_decides(void) {
+  FirmwareTrial trial;
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(500000, true));
+}
+
+void test_first_loop_pass_does_not_confirm(void) {
+  FirmwareTrial trial;
+  trial.begin(2000, WINDOW);
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(2010, false));
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(2000 + WINDOW - 1, false));
+}
+
+void test_delivery_tick_confirms(void) {
+  FirmwareTrial trial;
+  trial.begin(2000, WINDOW);
+  trial.recordDeliveryTick();
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_CONFIRM, trial.evaluate(3000, false));
+}
+
+void test_idle_schedule_confirms_after_window(void) {
+  FirmwareTrial trial;
+  trial.begin(2000, WINDOW);
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_CONFIRM, trial.evaluate(2000 + WINDOW, false));
+}
+
+void test_overdue_tick_rolls_back_after_window(void) {
+  FirmwareTrial trial;
+  trial.begin(2000, WINDOW);
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(60000, true));
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_ROLLBACK, trial.evaluate(2000 + WINDOW, true));
+}
+
+void test_window_across_millis_wrap(void) {
+  FirmwareTrial trial;
+  uint32_t start = 0xFFFF0000;
+  trial.begin(start, WINDOW);
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(start + 1000, true));
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_ROLLBACK, trial.evaluate(start + WINDOW, true));
+}
+
+void test_end_stops_decisions(void) {
+  FirmwareTrial trial;
+  trial.begin(0, WINDOW);
+  trial.end();
+  TEST_ASSERT_FALSE(trial.active());
+  TEST_ASSERT_EQUAL(FirmwareTrial::TRIAL_PENDING, trial.evaluate(WINDOW * 2, true));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_inactive_trial_never_decides);
+  RUN_TEST(test_first_loop_pass_does_not_confirm);
+  RUN_TEST(test_delivery_tick_confirms);
+  RUN_TEST(test_idle_schedule_confirms_after_window);
+  RUN_TEST(test_overdue_tick_rolls_back_after_window);
+  RUN_TEST(test_window_across_millis_wrap);
+  RUN_TEST(test_end_stops_decisions);
+  return UNITY_END();
+}
@@ -0,0 +1,161 @@
+/**
+ * Host tests for the pump state journal.
+ * FakeStore mimics the Preferences put/get API used on the device, and can
+ * lose power after a given number of writes.
+ */
+#include <unity.h>
+#include <map>
+#include <string>
+#include "PumpJournal.h"
+
+struct FakeStore {
+  std::map<std::string, bool> bools;
+  std::map<std::string, float> floats;
+  std::map<std::string, uint32_t> ulongs;
+  int writesLeft = -1;  // Unlimited
+
+  bool powered() {
+    if (writesLeft == 0) return false;
+    if (writesLeft > 0) writesLeft--;
+    return true;
+  }
+
+  size_t putBool(const char *key, bool value) { if (!powered()) return 0; bools[key] = value; return 1; }
+  size_t putFloat(const char *key, float value) { if (!powered()) return 0; floats[key] = value; return 4; }
+  size_t putULong(const char *key, uint32_t value) { if (!powered()) return 0; ulongs[key] = value; return 4; }
+  bool getBool(const char *key, bool fallback) { return bools.count(key) ? bools[key] : fallback; }
+  float getFloat(const char *key, float fallback) { return floats.count(key) ? floats[key] : fallback; }
+  uint32_t getULong(const char *key, uint32_t fallback) { return ulongs.count(key) ? ulongs[key] : fallback; }
+};
+
+static PumpJournal sampleJournal() {
+  PumpJournal journal;
+  journal.pumping = true;
+  journal.pendingUnits = 3.5;
+  journal.suspended = true;
+  journal.tempBasalActive = true;
+  journal.tempBasalRate = 1.25;
+  journal.tempBasalLeftMs = 900000;
+  journal.basalAgoMs = 42000;
+  return journal;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_no_journal_on_fresh_store(void) {
+  FakeStore store;
+  PumpJournal journal;
+  TEST_ASSERT_FALSE(loadPumpJournal(store, journal));
+}
+
+void test_round_trip(void) {
+  FakeStore store;
+  savePumpJournal(store, sampleJournal());
+
+  PumpJournal journal = {};
+  TEST_ASSERT_TRUE(loadPumpJournal(store, journal));
+  TEST_ASSERT_TRUE(journal.pumping);
+  TEST_ASSERT_EQUAL_FLOAT(3.5, journal.pendingUnits);
+  TEST_ASSERT_TRUE(journal.suspended);
+  TEST_ASSERT_TRUE(journal.tempBasalActive);
+  TEST_ASSERT_EQUAL_FLOAT(1.25, journal.tempBasalRate);
+  TEST_ASSERT_EQUAL_UINT32(900000, journal.tempBasalLeftMs);
+  TEST_ASSERT_EQUAL_UINT32(42000, journal.basalAgoMs);
+}
+
+void test_load_keeps_journal_until_cleared(void) {
+  FakeStore store;
+  savePumpJournal(store, sampleJournal());
+
+  // A trial image reads it, then crashes: the rolled-back image must see it too
+  PumpJournal journal;
+  TEST_ASSERT_TRUE(loadPumpJournal(store, journal));
+  TEST_ASSERT_TRUE(loadPumpJournal(store, journal));
+
+  clearPumpJournal(store);
+  TEST_ASSERT_FALSE(loadPumpJournal(store, journal));
+}
+
+void test_valid_flag_written_last(void) {
+  // A write torn before the flag leaves no journal behind
+  FakeStore store;
+  store.putBool("j_susp", true);
+  PumpJournal journal;
+  TEST_ASSERT_FALSE(loadPumpJournal(store, journal));
+}
+
+void test_torn_write_over_valid_journal(void) {
+  // Rollback journals over the pre-switch journal a trial image kept
+  PumpJournal next = {};
+  next.basalAgoMs = 7000;
+
+  // cut 0 never started the write; 9 completed it
+  for (int cut = 1; cut < 9; cut++) {
+    FakeStore store;
+    savePumpJournal(store, sampleJournal());
+    store.writesLeft = cut;
+    savePumpJournal(store, next);
+
+    // Power lost part way: no journal at all, never a stale j_pending
+    PumpJournal journal;
+    TEST_ASSERT_FALSE(loadPumpJournal(store, journal));
+  }
+
+  FakeStore store;
+  savePumpJournal(store, sampleJournal());
+  store.writesLeft = 9;
+  savePumpJournal(store, next);
+  PumpJournal journal;
+  TEST_ASSERT_TRUE(loadPumpJournal(store, journal));
+  TEST_ASSERT_FALSE(journal.pumping);
+  TEST_ASSERT_EQUAL_FLOAT(0.0, journal.pendingUnits);
+  TEST_ASSERT_EQUAL_UINT32(7000, journal.basalAgoMs);
+}
+
+void test_time_left(void) {
+  TEST_ASSERT_EQUAL_UINT32(0, journalTimeLeft(1000, false, 5000));
+  TEST_ASSERT_EQUAL_UINT32(4000, journalTimeLeft(1000, true, 5000));
+  TEST_ASSERT_EQUAL_UINT32(0, journalTimeLeft(6000, true, 5000));
+}
+
+void test_time_left_across_millis_wrap(void) {
+  uint32_t now = 0xFFFFF000;
+  uint32_t deadline = now + 10000;  // Wrapped past zero
+  TEST_ASSERT_EQUAL_UINT32(10000, journalTimeLeft(now, true, deadline));
+  TEST_ASSERT_EQUAL_UINT32(0, journalTimeLeft(deadline + 1, true, deadline));
+}
+
+void test_basal_phase_rebased_onto_new_boot(void) {
+  // Journalled 42 s after the last basal tick; the new image boots at 1.5 s
+  uint32_t bootNow = 1500;
+  PumpJournalClock clock = rebasePumpJournal(sampleJournal(), bootNow);
+  uint32_t later = bootNow + 3000;
+  TEST_ASSERT_EQUAL_UINT32(45000, later - clock.lastBasalTick);
+}
+
+void test_temp_basal_deadline_survives_switch(void) {
+  // Saved with 15 min left just before the wrap; restored on a fresh boot
+  uint32_t oldNow = 0xFFFFF000;
+  PumpJournal journal = sampleJournal();
+  journal.tempBasalLeftMs = journalTimeLeft(oldNow, true, oldNow + 900000);
+
+  uint32_t bootNow = 1500;
+  PumpJournalClock clock = rebasePumpJournal(journal, bootNow);
+  TEST_ASSERT_EQUAL_UINT32(900000, journalTimeLeft(bootNow, true, clock.tempBasalEnd));
+  TEST_ASSERT_EQUAL_UINT32(0, journalTimeLeft(bootNow + 900000, true, clock.tempBasalEnd));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_journal_on_fresh_store);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_load_keeps_journal_until_cleared);
+  RUN_TEST(test_valid_flag_written_last);
+  RUN_TEST(test_torn_write_over_valid_journal);
+  RUN_TEST(test_time_left);
+  RUN_TEST(test_time_left_across_millis_wrap);
+  RUN_TEST(test_basal_phase_rebased_onto_new_boot);
+  RUN_TEST(test_temp_basal_deadline_survives_switch);
+  return UNITY_END();
+}
@@ -0,0 +1,179 @@
+/**
+ * Host tests for the status schema.
+ * Checks every view the firmware renders against the JSON it used to
+ * build by hand, and that the table-derived capacities really bound it.
+ */
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include "StatusSchema.h"
+
+static PumpStatus sampleStatus() {
+  PumpStatus status;
+  status.deviceStatus = "DELIVERING_BOLUS";
+  status.timestamp = 1760000000123ULL;
+  status.delivered = 12.5;
+  status.remaining = 302.5;
+  status.capacity = 315.0;
+  status.basal = 0.85;
+  status.pending = 1.5;
+  status.lastBolus = 2.25;
+  status.tempBasalRate = 1.25;
+  status.tempBasalMinutes = 30;
+  status.rewindDurationMs = 1375;
+  status.empty = false;
+  status.pumping = true;
+  status.rewinding = false;
+  status.suspended = false;
+  status.tempBasalActive = false;
+  return status;
+}
+
+// Largest value each source can hold, to exercise the capacity bound.
+// Floats go well past the 32-bit range fixed() converts through.
+static PumpStatus worstCaseStatus(float unit) {
+  PumpStatus status;
+  status.deviceStatus = "DELIVERING_BASAL";
+  status.timestamp = 18446744073709551615ULL;
+  status.delivered = unit;
+  status.remaining = unit;
+  status.capacity = unit;
+  status.basal = unit;
+  status.pending = unit;
+  status.lastBolus = unit;
+  status.tempBasalRate = unit;
+  status.tempBasalMinutes = 4294967295U;
+  status.rewindDurationMs = 4294967295U;
+  status.empty = false;
+  status.pumping = false;
+  status.rewinding = false;
+  status.suspended = false;
+  status.tempBasalActive = false;
+  return status;
+}
+
+static void assertView(uint8_t view, const char *expected) {
+  char out[512];
+  size_t len = writeStatusView(out, sizeof(out), view, sampleStatus());
+  TEST_ASSERT_EQUAL_STRING(expected, out);
+  TEST_ASSERT_EQUAL(strlen(expected), len);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_events_view(void) {
+  assertView(VIEW_EVENTS,
+    "{\"delivered\":12.5,\"remaining\":302.5,\"capacity\":315.0,\"basal\":0.9,"
+    "\"empty\":false,\"pumping\":true,\"rewinding\":false,\"suspended\":false,\"pending\":1.5}");
+}
+
+void test_info_view(void) {
+  assertView(VIEW_INFO,
+    "{\"serialNumber\":\"ESP32-PUMP-001\",\"firmwareVersion\":\"" FIRMWARE_VERSION "\","
+    "\"hardwareVersion\":\"v1.0-WormDrive\",\"deviceStatus\":\"DELIVERING_BOLUS\","
+    "\"batteryPercentage\":100,\"reservoirVolume\":302.5,\"activationStage\":5,"
+    "\"communicationStatus\":\"CONNECTED\"}");
+}
+
+void test_status_view(void) {
+  assertView(VIEW_STATUS,
+    "{\"deviceStatus\":\"DELIVERING_BOLUS\",\"batteryPercentage\":100,\"reservoirVolume\":302.5,"
+    "\"connectionState\":\"AUTHENTICATED_AND_READY\",\"timestamp\":1760000000123}");
+}
+
+void test_command_views(void) {
+  assertView(VIEW_COMMAND, "{\"deviceStatus\":\"DELIVERING_BOLUS\"}");
+  assertView(VIEW_BOLUS, "{\"unitsDelivered\":2.25,\"startTime\":1760000000123}");
+  assertView(VIEW_TEMP_BASAL, "{\"rate\":1.25,\"durationMinutes\":30}");
+  assertView(VIEW_RESET, "{\"deviceStatus\":\"DELIVERING_BOLUS\",\"estimatedRewindDurationMs\":1375}");
+}
+
+void test_fixed_point_rounding(void) {
+  PumpStatus status = sampleStatus();
+  char out[64];
+  status.tempBasalRate = 0.05f;
+  writeStatusView(out, sizeof(out), VIEW_TEMP_BASAL, status);
+  TEST_ASSERT_EQUAL_STRING("{\"rate\":0.05,\"durationMinutes\":30}", out);
+  status.tempBasalRate = 0.999f;
+  writeStatusView(out, sizeof(out), VIEW_TEMP_BASAL, status);
+  TEST_ASSERT_EQUAL_STRING("{\"rate\":1.00,\"durationMinutes\":30}", out);
+  status.tempBasalRate = -0.5f;
+  writeStatusView(out, sizeof(out), VIEW_TEMP_BASAL, status);
+  TEST_ASSERT_EQUAL_STRING("{\"rate\":-0.50,\"durationMinutes\":30}", out);
+}
+
+void test_overflow_returns_zero(void) {
+  char out[16];
+  TEST_ASSERT_EQUAL(0, writeStatusView(out, sizeof(out), VIEW_EVENTS, sampleStatus()));
+  TEST_ASSERT_EQUAL('\0', out[sizeof(out) - 1]);
+}
+
+void test_capacity_bounds_worst_case(void) {
+  const uint8_t views[] = { VIEW_EVENTS, VIEW_INFO, VIEW_STATUS, VIEW_COMMAND,
+                            VIEW_BOLUS, VIEW_TEMP_BASAL, VIEW_RESET };
+  const float units[] = { -4000000000.0f, -1e16f, 1e16f, -3.0e38f, 1e8f };
+  for (float unit : units) {
+    PumpStatus status = worstCaseStatus(unit);
+    for (uint8_t view : views) {
+      char out[512];
+      size_t cap = statusViewCapacity(view);
+      TEST_ASSERT_TRUE(cap <= sizeof(out));
+      size_t len = writeStatusView(out, cap, view, status);
+      TEST_ASSERT_TRUE(len > 0);
+      TEST_ASSERT_TRUE(len < cap);
+    }
+  }
+}
+
+void test_fixed_point_clamps_out_of_range(void) {
+  PumpStatus status = sampleStatus();
+  char out[64];
+  status.tempBasalRate = 1e8f;  // Past 32 bits once scaled by 100
+  writeStatusView(out, sizeof(out), VIEW_TEMP_BASAL, status);
+  TEST_ASSERT_EQUAL_STRING("{\"rate\":40000000.00,\"durationMinutes\":30}", out);
+  status.lastBolus = -1e16f;
+  writeStatusView(out, sizeof(out), VIEW_BOLUS, status);
+  TEST_ASSERT_EQUAL_STRING("{\"unitsDelivered\":-40000000.00,\"startTime\":1760000000123}", out);
+  status.lastBolus = NAN;
+  writeStatusView(out, sizeof(out), VIEW_BOLUS, status);
+  TEST_ASSERT_EQUAL_STRING("{\"unitsDelivered\":40000000.00,\"startTime\":1760000000123}", out);
+}
+
+void test_oled_values_are_plain_text(void) {
+  PumpStatus status = sampleStatus();
+  char value[24];
+  TEST_ASSERT_EQUAL_STRING("DELIVERING_BOLUS", formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_DEVICE_STATUS, status));
+  TEST_ASSERT_EQUAL_STRING("302.5", formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_REMAINING, status));
+  TEST_ASSERT_EQUAL_STRING("0.9", formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_BASAL, status));
+  TEST_ASSERT_EQUAL_STRING("1.5", formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_PENDING, status));
+  TEST_ASSERT_EQUAL_STRING("2.3", formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_LAST_BOLUS, status));
+}
+
+void test_display_only_rows_have_no_key(void) {
+  for (const StatusField &f : STATUS_FIELDS) {
+    if (f.views == VIEW_OLED) TEST_ASSERT_TRUE(f.key == nullptr);
+  }
+}
+
+void test_oled_value_truncates_safely(void) {
+  char value[6];
+  formatStatusValue(value, sizeof(value), VIEW_OLED, SRC_DEVICE_STATUS, sampleStatus());
+  TEST_ASSERT_EQUAL_STRING("DELIV", value);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_events_view);
+  RUN_TEST(test_info_view);
+  RUN_TEST(test_status_view);
+  RUN_TEST(test_command_views);
+  RUN_TEST(test_fixed_point_rounding);
+  RUN_TEST(test_fixed_point_clamps_out_of_range);
+  RUN_TEST(test_overflow_returns_zero);
+  RUN_TEST(test_capacity_bounds_worst_case);
+  RUN_TEST(test_oled_values_are_plain_text);
+  RUN_TEST(test_display_only_rows_have_no_key);
+  RUN_TEST(test_oled_value_truncates_safely);
+  return UNITY_END();
+}